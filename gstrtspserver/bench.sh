@@ -0,0 +1,164 @@
+#!/bin/bash
+# Runs camera_server with synthetic sources, connects test_client --headless
+# instances to every mount and compares the results with a stored baseline.
+#
+# Exits with 1 if any metric regressed by more than the threshold, 2 if there
+# is no baseline to compare with (record one with --save-baseline).
+
+WIDTH=640
+HEIGHT=480
+FRAMERATE=30
+MOUNTS=1
+CLIENTS=1          # per mount
+WARMUP=5
+DURATION=30
+PORT=8554
+THRESHOLD=10       # percent
+BASELINE=bench-baseline.txt
+SAVE=0
+
+usage()
+{
+    echo "usage: $0 [--width W] [--height H] [--framerate FPS] [--mounts N]"
+    echo "          [--clients N] [--warmup S] [--duration S] [--port PORT]"
+    echo "          [--threshold PERCENT] [--baseline FILE] [--save-baseline]"
+    exit 2
+}
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --width) WIDTH=$2; shift ;;
+        --height) HEIGHT=$2; shift ;;
+        --framerate) FRAMERATE=$2; shift ;;
+        --mounts) MOUNTS=$2; shift ;;
+        --clients) CLIENTS=$2; shift ;;
+        --warmup) WARMUP=$2; shift ;;
+        --duration) DURATION=$2; shift ;;
+        --port) PORT=$2; shift ;;
+        --threshold) THRESHOLD=$2; shift ;;
+        --baseline) BASELINE=$2; shift ;;
+        --save-baseline) SAVE=1 ;;
+        *) usage ;;
+    esac
+    shift
+done
+
+[ "$MOUNTS" -ge 1 ] 2>/dev/null && [ "$CLIENTS" -ge 1 ] 2>/dev/null || usage
+
+OUT=$(mktemp -d)
+CLIENT_PIDS=()
+trap 'kill $SERVER "${CLIENT_PIDS[@]}" 2>/dev/null; rm -rf "$OUT"' EXIT
+
+./camera_server --synthetic --width "$WIDTH" --height "$HEIGHT" --framerate "$FRAMERATE" \
+    --mounts "$MOUNTS" --warmup "$WARMUP" --duration "$DURATION" \
+    --port "$PORT" > "$OUT/server" 2>&1 &
+SERVER=$!
+
+# don't connect before the server is listening
+for ((i = 0; i < 100; i++)); do
+    grep -q '^Serving ' "$OUT/server" && break
+    kill -0 $SERVER 2>/dev/null || break
+    sleep 0.1
+done
+if ! grep -q '^Serving ' "$OUT/server"; then
+    echo "camera_server did not start:"
+    cat "$OUT/server"
+    exit 1
+fi
+
+# clients play until the server has stopped measuring
+for ((m = 0; m < MOUNTS; m++)); do
+    MOUNT=test
+    [ $m -gt 0 ] && MOUNT=test$m
+    for ((c = 0; c < CLIENTS; c++)); do
+        ./test_client --headless --url "rtsp://localhost:$PORT/$MOUNT" \
+            --duration $((WARMUP + DURATION)) > "$OUT/client-$m-$c" 2>&1 &
+        CLIENT_PIDS+=($!)
+    done
+done
+
+wait $SERVER || { echo "camera_server failed:"; cat "$OUT/server"; exit 1; }
+
+# every client has to have played, otherwise the latency average is a lie
+FAILED=0
+for pid in "${CLIENT_PIDS[@]}"; do
+    wait $pid || FAILED=1
+done
+for f in "$OUT"/client-*; do
+    if ! grep -q '^BENCH ' "$f"; then
+        echo "${f##*/} got no video:"
+        cat "$f"
+        FAILED=1
+    fi
+done
+[ $FAILED -eq 0 ] || exit 1
+
+# server metrics go through as is, client setup latency is averaged
+{
+    echo "config ${WIDTH}x${HEIGHT}@${FRAMERATE},mounts=${MOUNTS},clients=${CLIENTS},warmup=${WARMUP},duration=${DURATION}"
+    grep '^BENCH ' "$OUT/server" | cut -d' ' -f2-
+    cat "$OUT"/client-* | awk '
+        /^BENCH setup_latency_ms / { sum += $3; if ($3 > max) max = $3; n++ }
+        END {
+            printf "setup_latency_ms %.1f\n", sum / n
+            printf "setup_latency_max_ms %.1f\n", max
+        }'
+} > "$OUT/results"
+
+cat "$OUT/results"
+
+if [ $SAVE -eq 1 ]; then
+    cp "$OUT/results" "$BASELINE"
+    echo "Saved baseline to $BASELINE"
+    exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline in $BASELINE, record one with --save-baseline"
+    exit 2
+fi
+
+if [ "$(grep '^config ' "$BASELINE")" != "$(grep '^config ' "$OUT/results")" ]; then
+    echo "Baseline $BASELINE was recorded with a different configuration:"
+    grep '^config ' "$BASELINE"
+    exit 2
+fi
+
+# encoder_fps regresses when it goes down, everything else when it goes up.
+# The slack keeps metrics whose baseline is near zero from flagging on noise.
+printf "%-22s %12s %12s\n" metric baseline current
+awk -v threshold="$THRESHOLD" '
+    BEGIN {
+        slack["cpu_percent"] = 2
+        slack["rss_kb"] = 1024
+        slack["rss_growth_kb"] = 1024
+        slack["encoder_fps"] = 0.5
+        slack["dropped_frames"] = 5
+        slack["setup_latency_ms"] = 20
+        slack["setup_latency_max_ms"] = 20
+    }
+    $1 == "config" { next }
+    FNR == NR { base[$1] = $2; order[++n] = $1; next }
+    { current[$1] = $2 }
+    END {
+        for (i = 1; i <= n; i++) {
+            key = order[i]
+            if (!(key in current)) {
+                printf "%-22s %12s %12s  MISSING\n", key, base[key], "-"
+                failed = 1
+                continue
+            }
+            allowed = base[key] * threshold / 100
+            if (allowed < slack[key])
+                allowed = slack[key]
+            delta = (key == "encoder_fps") ? base[key] - current[key] : current[key] - base[key]
+            status = "ok"
+            if (delta > allowed) {
+                status = "REGRESSION"
+                failed = 1
+            }
+            printf "%-22s %12s %12s  %s\n", key, base[key], current[key], status
+        }
+        exit failed
+    }
+' "$BASELINE" "$OUT/results"
@@ -21,6 +21,10 @@
 
 #include <gst/gst.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <cstdio>
+#include <sstream>
 #include <string>
 
 #include <gst/rtsp-server/rtsp-server.h>
@@ -47,11 +51,159 @@ void attachInterruptHandlers()
     signal(SIGTERM, &terminateSignalHandler);
 }
 
+// command line options
+gboolean synthetic = FALSE;
+gint width = 640;
+gint height = 480;
+gint framerate = 30;
+gint mounts = 1;
+gchar *port = NULL;
+gint warmup = 5;
+gint duration = 0;
+
+GOptionEntry entries[] =
+{
+    { "synthetic", 0, 0, G_OPTION_ARG_NONE, &synthetic, "Use videotestsrc/audiotestsrc instead of v4l2src/autoaudiosrc", NULL },
+    { "width", 0, 0, G_OPTION_ARG_INT, &width, "Video width (default 640)", "W" },
+    { "height", 0, 0, G_OPTION_ARG_INT, &height, "Video height (default 480)", "H" },
+    { "framerate", 0, 0, G_OPTION_ARG_INT, &framerate, "Video frames per second (default 30)", "FPS" },
+    { "mounts", 0, 0, G_OPTION_ARG_INT, &mounts, "Number of mount points: /test, /test1, /test2...", "N" },
+    { "port", 0, 0, G_OPTION_ARG_STRING, &port, "Port to listen on (default 8554)", "PORT" },
+    { "warmup", 0, 0, G_OPTION_ARG_INT, &warmup, "Seconds to run before measuring (default 5)", "S" },
+    { "duration", 0, 0, G_OPTION_ARG_INT, &duration, "Measure for this many seconds, print BENCH lines and quit", "S" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+/* frame counters for one mount, incremented from the streaming threads.
+ * These are never freed: the media pipelines are still running when main
+ * returns, so the probes can fire after it. */
+struct Mount {
+    gint in;            // buffers into the video queue
+    gint out;           // buffers out of the encoder
+    gint inAtStart;
+    gint outAtStart;
+};
+
+// resource usage at one point in time
+struct Sample {
+    gint64 timeUs;
+    gint64 cpuUs;
+    long rssKb;
+};
+
 struct Data {
     GstRTSPServer *server;
     GMainLoop *loop;
+    Mount *mounts;
+    Sample start;
+    bool reported;
 };
 
+gint64 toUs(const struct timeval &tv)
+{
+    return static_cast<gint64>(tv.tv_sec) * G_USEC_PER_SEC + tv.tv_usec;
+}
+
+long residentKb()
+{
+    long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+        return 0;
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+Sample takeSample()
+{
+    Sample sample;
+    sample.timeUs = g_get_monotonic_time();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample.cpuUs = toUs(usage.ru_utime) + toUs(usage.ru_stime);
+    sample.rssKb = residentKb();
+    return sample;
+}
+
+gboolean
+countIn (GstPad * /*pad*/, GstBuffer * /*buffer*/, Mount *mount)
+{
+    g_atomic_int_inc(&mount->in);
+    return TRUE;
+}
+
+gboolean
+countOut (GstPad * /*pad*/, GstBuffer * /*buffer*/, Mount *mount)
+{
+    g_atomic_int_inc(&mount->out);
+    return TRUE;
+}
+
+void addProbe(GstElement *pipeline, const gchar *name, const gchar *padName,
+        GCallback callback, Mount *mount)
+{
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), name);
+    g_assert(element);
+    GstPad *pad = gst_element_get_static_pad(element, padName);
+    gst_pad_add_buffer_probe(pad, callback, mount);
+    gst_object_unref(pad);
+    gst_object_unref(element);
+}
+
+gboolean
+startMeasuring (Data *data)
+{
+    for (gint i = 0; i < mounts; ++i)
+    {
+        Mount &m = data->mounts[i];
+        m.inAtStart = g_atomic_int_get(&m.in);
+        m.outAtStart = g_atomic_int_get(&m.out);
+    }
+    data->start = takeSample();
+    g_print("Warmup done, measuring for %d seconds...\n", duration);
+    return FALSE;
+}
+
+gboolean
+stopMeasuring (Data *data)
+{
+    Sample end = takeSample();
+    const double seconds = (end.timeUs - data->start.timeUs) / static_cast<double>(G_USEC_PER_SEC);
+
+    gint encoded = 0;
+    gint dropped = 0;
+    const gint expected = static_cast<gint>(framerate * seconds);
+    for (gint i = 0; i < mounts; ++i)
+    {
+        Mount &m = data->mounts[i];
+        encoded += g_atomic_int_get(&m.out) - m.outAtStart;
+        // a mount without frames before the window has no media (no client)
+        if (m.inAtStart == 0)
+            continue;
+        /* the video queue isn't leaky, so a slow encoder stalls the source
+         * instead and the frames it never produced are the ones lost against
+         * the configured rate */
+        const gint in = g_atomic_int_get(&m.in) - m.inAtStart;
+        if (in < expected)
+            dropped += expected - in;
+    }
+
+    g_print("BENCH cpu_percent %.1f\n", 100.0 * (end.cpuUs - data->start.cpuUs) / (end.timeUs - data->start.timeUs));
+    g_print("BENCH rss_kb %ld\n", end.rssKb);
+    g_print("BENCH rss_growth_kb %ld\n", end.rssKb - data->start.rssKb);
+    g_print("BENCH encoder_fps %.2f\n", encoded / seconds / mounts);
+    g_print("BENCH dropped_frames %d\n", dropped);
+    fflush(stdout); // don't lose these if teardown crashes
+    data->reported = true;
+
+    if (data->loop)
+        g_main_loop_quit(data->loop);
+    return FALSE;
+}
+
 void cleanSessions(GstRTSPServer *server)
 {
   GstRTSPSessionPool *pool;
@@ -82,6 +234,18 @@ timeout (Data *data, gboolean /*ignored*/)
   return result;
 }
 
+std::string launchLine()
+{
+    std::ostringstream line;
+    line << "( " << (synthetic ? "videotestsrc is-live=true" : "v4l2src")
+        << " ! video/x-raw-yuv,width=" << width << ",height=" << height
+        << ",framerate=" << framerate << "/1,format=(fourcc)UYVY ! "
+        "ffmpegcolorspace ! timeoverlay ! queue name=vqueue ! ffenc_mpeg4 name=enc bitrate=3000000 ! rtpmp4vpay name=pay0 pt=96 "
+        << (synthetic ? "audiotestsrc is-live=true" : "autoaudiosrc")
+        << " ! queue ! audioconvert ! rtpL16pay max-ptime=2000000 name=pay1 pt=97 )";
+    return line.str();
+}
+
 } // end anonymous namespace
 
 int
@@ -89,50 +253,82 @@ main (int argc, char *argv[])
 {
   attachInterruptHandlers();
 
-  Data data;
-  GstRTSPMediaMapping *mapping;
-  GstRTSPMediaFactory *factory;
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("- RTSP camera server");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+      g_print("option parsing failed: %s\n", error->message);
+      g_error_free(error);
+      return 1;
+  }
+  g_option_context_free(context);
 
-  gst_init (&argc, &argv);
+  if (width <= 0 or height <= 0 or framerate <= 0 or mounts <= 0 or warmup < 0 or duration < 0)
+  {
+      g_print("width, height, framerate and mounts must be positive, warmup and duration must not be negative\n");
+      return 1;
+  }
 
+  Data data;
+  data.mounts = g_new0(Mount, mounts);
+  data.reported = false;
+  GstRTSPMediaMapping *mapping;
 
   /* create the main loop */
   data.loop = g_main_loop_new (NULL, FALSE);
   /* create a server instance */
   data.server = gst_rtsp_server_new ();
+  if (port)
+      gst_rtsp_server_set_service (data.server, port);
 
   /* get the mapping for this server, every server has a default mapper object
    * that be used to map uri mount points to media factories */
   mapping = gst_rtsp_server_get_media_mapping (data.server);
-  /* don't need the ref to the mapper anymore */
-  g_object_unref (mapping);
-
 
-  /* make a media factory for a test stream. The default media factory can use
-   * gst-launch syntax to create pipelines. 
-   * any launch line works as long as it contains elements named pay%d. Each
-   * element with pay%d names will be a stream */
-  factory = GST_RTSP_MEDIA_FACTORY(gst_rtsp_media_factory_custom_new());
+  const std::string line(launchLine());
+  for (gint i = 0; i < mounts; ++i)
+  {
+      /* make a media factory for a test stream. The default media factory can use
+       * gst-launch syntax to create pipelines. 
+       * any launch line works as long as it contains elements named pay%d. Each
+       * element with pay%d names will be a stream */
+      GstRTSPMediaFactory *factory = GST_RTSP_MEDIA_FACTORY(gst_rtsp_media_factory_custom_new());
 
-  // allow multiple clients to see the same video
-  gst_rtsp_media_factory_set_shared (factory, TRUE);
+      // allow multiple clients to see the same video
+      gst_rtsp_media_factory_set_shared (factory, TRUE);
 
-  static const std::string launchLine("( v4l2src ! video/x-raw-yuv,width=640,height=480,framerate=30/1,format=(fourcc)UYVY ! "
-      "ffmpegcolorspace ! timeoverlay ! queue ! ffenc_mpeg4 bitrate=3000000 ! rtpmp4vpay name=pay0 pt=96 "
-      "autoaudiosrc ! queue ! audioconvert ! rtpL16pay max-ptime=2000000 name=pay1 pt=97 )");
+      GstElement *pipeline = gst_parse_launch(line.c_str(), &error);
+      if (pipeline == NULL)
+      {
+          g_critical ("could not parse launch syntax (%s): %s", line.c_str(),
+                  (error ? error->message : "unknown reason"));
+          return 1;
+      }
+      if (error)
+      {
+          g_error_free (error);
+          error = NULL;
+      }
 
-  GError *error = NULL;
-  GstElement *pipeline = gst_parse_launch(launchLine.c_str(), &error);
-  if (pipeline == NULL)
-      g_critical ("could not parse launch syntax (%s): %s", launchLine.c_str(),
-              (error ? error->message : "unknown reason"));
-  if (error)
-      g_error_free (error);
+      if (duration)
+      {
+          // count video frames into the queue and out of the encoder
+          Mount &m = data.mounts[i];
+          addProbe(pipeline, "vqueue", "sink", G_CALLBACK(countIn), &m);
+          addProbe(pipeline, "enc", "src", G_CALLBACK(countOut), &m);
+      }
 
-  g_object_set(factory, "bin", pipeline, NULL);
+      g_object_set(factory, "bin", pipeline, NULL);
 
-  /* attach the test factory to the /test url */
-  gst_rtsp_media_mapping_add_factory (mapping, "/test", factory);
+      /* attach the factory to the /test url, extra mounts get /test1, /test2... */
+      gchar *path = i ? g_strdup_printf("/test%d", i) : g_strdup("/test");
+      gst_rtsp_media_mapping_add_factory (mapping, path, factory);
+      g_free(path);
+  }
+  /* don't need the ref to the mapper anymore */
+  g_object_unref (mapping);
 
   guint id;
   /* attach the server to the default maincontext */
@@ -141,10 +337,21 @@ main (int argc, char *argv[])
     g_print ("failed to attach the server\n");
     return -1;
   }
+  gchar *service = gst_rtsp_server_get_service(data.server);
+  g_print("Serving %d mount(s) of %dx%d@%d on port %s\n", mounts, width, height,
+          framerate, service);
+  g_free(service);
+  fflush(stdout); // bench.sh waits for this line
 
   /* add a timeout for the session cleanup */
   g_timeout_add_seconds(1, (GSourceFunc) timeout, &data);
 
+  if (duration)
+  {
+      g_timeout_add_seconds(warmup, (GSourceFunc) startMeasuring, &data);
+      g_timeout_add_seconds(warmup + duration, (GSourceFunc) stopMeasuring, &data);
+  }
+
   /* start serving, this never stops */
   g_main_loop_run (data.loop);
 
@@ -154,5 +361,6 @@ main (int argc, char *argv[])
   g_object_unref(data.server);
   g_print("Exitting...\n");
 
-  return 0;
+  // a benchmark run that was interrupted before reporting failed
+  return (duration and not data.reported) ? 1 : 0;
 }
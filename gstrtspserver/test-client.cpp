@@ -19,15 +19,32 @@
 
 #include <gst/gst.h>
 #include <unistd.h>
+#include <string>
 
 struct Client {
-    Client () : pipeline(0), rtpbin(0), loop(0) {}
+    Client () : pipeline(0), rtpbin(0), loop(0), frames(0), firstFrameUs(0), startUs(0) {}
     GstElement *pipeline;
     GstElement *rtpbin;
     GMainLoop *loop;
+    gint frames;            // decoded video frames, only counted with --headless
+    gint64 firstFrameUs;
+    gint64 startUs;
 };
 
 namespace {
+// command line options
+gchar *url = NULL;
+gint duration = 0;
+gboolean headless = FALSE;
+
+GOptionEntry entries[] =
+{
+    { "url", 0, 0, G_OPTION_ARG_STRING, &url, "Stream to play (default rtsp://localhost:8554/test)", "URL" },
+    { "duration", 0, 0, G_OPTION_ARG_INT, &duration, "Quit after this many seconds", "S" },
+    { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "Play into fakesinks and print BENCH lines with setup latency and frames received", NULL },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
 volatile int interrupted = 0; // caught signals will be stored here
 void terminateSignalHandler(int sig)
 {
@@ -54,6 +71,21 @@ timeout (Client *client, gboolean /*ignored*/)
     return TRUE;
 }
 
+gboolean
+finished (Client *client)
+{
+    if (client->loop)
+        g_main_loop_quit(client->loop);
+    return FALSE;
+}
+
+// called from the streaming thread for every decoded video frame
+void handoff (GstElement * /*sink*/, GstBuffer * /*buffer*/, GstPad * /*pad*/, Client *client)
+{
+    if (g_atomic_int_add(&client->frames, 1) == 0)
+        client->firstFrameUs = g_get_monotonic_time();
+}
+
 gboolean bus_call(GstBus * /*bus*/, GstMessage *msg, void *user_data)
 {
     Client *context = static_cast<Client*>(user_data);
@@ -115,10 +147,36 @@ gboolean bus_call(GstBus * /*bus*/, GstMessage *msg, void *user_data)
 int main (int argc, char *argv[])
 {
     attachInterruptHandlers();
-    gst_init(&argc, &argv);
+
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- RTSP test client");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_print("option parsing failed: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_option_context_free(context);
+
     Client client;
 
-    client.pipeline = gst_parse_launch("uridecodebin uri=rtsp://localhost:8554/test name=decode ! queue ! ffmpegcolorspace ! timeoverlay halignment=right ! xvimagesink decode. ! queue ! audioconvert ! autoaudiosink buffer-time=15000", 0);
+    // --headless only swaps the sinks for fakesinks, so it runs without X or
+    // a sound card
+    const std::string launchLine("uridecodebin uri=" + std::string(url ? url : "rtsp://localhost:8554/test") +
+            " name=decode ! queue ! ffmpegcolorspace ! timeoverlay halignment=right ! " +
+            (headless ? "fakesink name=videosink sync=false signal-handoffs=true" : "xvimagesink") +
+            " decode. ! queue ! audioconvert ! " +
+            (headless ? "fakesink sync=false" : "autoaudiosink buffer-time=15000"));
+    client.pipeline = gst_parse_launch(launchLine.c_str(), 0);
+
+    if (headless)
+    {
+        GstElement *videosink = gst_bin_get_by_name(GST_BIN(client.pipeline), "videosink");
+        g_signal_connect(videosink, "handoff", G_CALLBACK(handoff), &client);
+        gst_object_unref(videosink);
+    }
 
     // add bus call
     GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(client.pipeline));
@@ -126,6 +184,7 @@ int main (int argc, char *argv[])
     gst_object_unref(bus);
 
     /* run */
+    client.startUs = g_get_monotonic_time();
     GstStateChangeReturn ret = gst_element_set_state (client.pipeline, GST_STATE_PLAYING);
 
     int tries = 0;
@@ -147,7 +206,9 @@ int main (int argc, char *argv[])
 
     /* add a timeout to check the interrupted variable */
     g_timeout_add_seconds(1, (GSourceFunc) timeout, &client);
-    
+    if (duration > 0)
+        g_timeout_add_seconds(duration, (GSourceFunc) finished, &client);
+
     g_object_set(client.rtpbin, "latency", 15, NULL);
 
     /* start loop */
@@ -157,6 +218,18 @@ int main (int argc, char *argv[])
     gst_element_set_state (client.pipeline, GST_STATE_NULL);
     gst_object_unref (client.pipeline);
 
+    if (headless)
+    {
+        const gint frames = g_atomic_int_get(&client.frames);
+        if (frames == 0)
+        {
+            g_print("No video frames received\n");
+            return 1;
+        }
+        g_print("BENCH setup_latency_ms %.1f\n", (client.firstFrameUs - client.startUs) / 1000.0);
+        g_print("BENCH frames_received %d\n", frames);
+    }
+
     g_print("Client exitting...\n");
 
     return 0;